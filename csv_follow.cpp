@@ -0,0 +1,279 @@
+#include "csv_follow.hpp"
+#include <fstream>
+#include <thread>
+#include <algorithm>
+#ifndef _WIN32
+#include <sys/stat.h>
+#endif
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+using std::string;
+using std::string_view;
+using std::chrono::milliseconds;
+namespace fs = std::filesystem;
+
+/**
+ * Design Notes
+ *  1.  follow_state.offset is only advanced past complete lines. The bytes after it that have been read are kept in
+ *      pending, along with how far they've been scanned and the quote state there, so each poll only reads & scans
+ *      the bytes appended since the previous one.
+ *  2.  inotify watches the directory rather than the file so the watch survives the file being rotated.
+ *  3.  A replaced file is detected by a change of inode (where available) or of its first bytes; a truncated one
+ *      by its size dropping below what has been read.
+ *  4.  The file stays open between polls, so lines appended to it just before it's rotated are still read from the
+ *      old file before moving on to the new one. Windows doesn't allow an open file to be renamed, so there it's
+ *      reopened on each poll instead.
+ */
+
+constexpr size_t head_size = 64;     // bytes of the file kept to detect it being replaced
+constexpr size_t read_size = 1 << 16; // bytes read from the file at a time
+
+uint64_t file_identity(fs::path const& path) {
+#ifndef _WIN32
+    struct stat st;
+    if (::stat(path.c_str(), &st) == 0)
+        return static_cast<uint64_t>(st.st_ino);
+#endif
+    return 0;
+}
+
+// 1 if symbol is at pos, 0 if not, -1 if the bytes at pos are only the start of symbol and more are needed
+int match_symbol_at(string const& buf, size_t pos, string const& symbol) {
+    if (symbol.empty())
+        return 0;
+    size_t const n = std::min(symbol.size(), buf.size() - pos);
+    if (buf.compare(pos, n, symbol, 0, n) != 0)
+        return 0;
+    return n == symbol.size() ? 1 : -1;
+}
+
+csv_follower::csv_follower(fs::path file_path
+    , csv_flags follow_flags
+    , string seps
+    , string quote_lead
+    , string quote_trail
+    , string whitesp
+    , milliseconds interval)
+    : path(std::move(file_path))
+    , flags(follow_flags)
+    , sep_charset(std::move(seps))
+    , quote_lead_symbol(std::move(quote_lead))
+    , quote_trail_symbol(std::move(quote_trail))
+    , whitesp_charset(std::move(whitesp))
+    , poll_interval(interval) {
+#ifdef __linux__
+    notify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (notify_fd >= 0) {
+        fs::path dir = path.parent_path();
+        if (dir.empty())
+            dir = ".";
+        notify_wd = inotify_add_watch(notify_fd, dir.c_str(), IN_MODIFY | IN_CREATE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE | IN_CLOSE_WRITE);
+        if (notify_wd < 0) { // fall back to polling
+            ::close(notify_fd);
+            notify_fd = -1;
+        }
+    }
+#endif
+}
+
+csv_follower::~csv_follower() {
+#ifdef __linux__
+    if (notify_fd >= 0)
+        ::close(notify_fd);
+#endif
+}
+
+void csv_follower::restore(csv_follow_state const& st) {
+    follow_state = st;
+    file.close();
+    pending.clear();
+    pending_scanned = 0;
+    pending_in_quote = false;
+    pending_fld_start = true;
+}
+
+void csv_follower::reset() {
+    follow_state.offset = 0;
+    follow_state.col_names.clear();
+    follow_state.head.clear();
+    follow_state.file_id = 0;
+    file.close();
+    pending.clear();
+    pending_scanned = 0;
+    pending_in_quote = false;
+    pending_fld_start = true;
+}
+
+bool csv_follower::check_replaced(uint64_t file_size) {
+    uint64_t const read_offset = follow_state.offset + pending.size();
+    if (file_size < read_offset)
+        return true; // truncated
+
+    uint64_t const id = file_identity(path);
+    if (follow_state.file_id != 0 && id != 0 && id != follow_state.file_id)
+        return true; // rotated
+    follow_state.file_id = id;
+
+    // first bytes changed?
+    size_t const head_len = static_cast<size_t>(std::min<uint64_t>(file_size, head_size));
+    if (head_len > 0) {
+        string head(head_len, '\0');
+        std::ifstream in(path, std::ios::binary);
+        if (!in.read(head.data(), head_len))
+            return false;
+        if (head.compare(0, follow_state.head.size(), follow_state.head) != 0)
+            return true;
+        follow_state.head = std::move(head);
+    }
+    return false;
+}
+
+void csv_follower::read_line(string_view line, line_action const& action, size_t& line_count) {
+    if (!line.empty() && line.back() == '\r')
+        line.remove_suffix(1);
+
+    // header row
+    if ((flags & csv_flags::has_header_row) == csv_flags::has_header_row && follow_state.offset == 0 && follow_state.col_names.empty()) {
+        auto add_name = [&](string_view fld) { follow_state.col_names.emplace_back(fld); };
+        parse_line(line, sep_charset, quote_lead_symbol, quote_trail_symbol, whitesp_charset, flags, add_name);
+        return;
+    }
+    if (line.empty() && (flags & csv_flags::skip_empty_lines) == csv_flags::skip_empty_lines)
+        return;
+
+    accum_line_types(follow_state.col_types, eval_line_types(line, sep_charset, quote_lead_symbol, quote_trail_symbol, whitesp_charset, flags));
+    action(line, follow_state.col_types);
+    ++line_count;
+}
+
+void csv_follower::scan_pending(line_action const& action, size_t& line_count) {
+    // scan for line ends, outside of quotes
+    size_t line_start = 0;
+    size_t pos = pending_scanned;
+    for (; pos < pending.size(); ++pos) {
+        if (pending_in_quote) {
+            int const m = match_symbol_at(pending, pos, quote_trail_symbol);
+            if (m < 0)
+                break;
+            if (m > 0) {
+                pending_in_quote = false;
+                pos += quote_trail_symbol.size() - 1;
+            }
+        }
+        else if (pending[pos] == '\n') {
+            try {
+                read_line(string_view(pending).substr(line_start, pos - line_start), action, line_count);
+            }
+            catch (...) {
+                // keep the lines before this one committed; this one is scanned & passed again by the next poll
+                pending.erase(0, line_start);
+                pending_scanned = 0;
+                pending_in_quote = false;
+                pending_fld_start = true;
+                throw;
+            }
+            follow_state.offset += pos + 1 - line_start;
+            line_start = pos + 1;
+            pending_fld_start = true;
+        }
+        else if (match_any_char(pending.begin() + pos, sep_charset)) {
+            pending_fld_start = true;
+        }
+        else if (pending_fld_start && !match_any_char(pending.begin() + pos, whitesp_charset)) {
+            // a quote only opens a value at the start of a field, as in parse_line
+            int const m = match_symbol_at(pending, pos, quote_lead_symbol);
+            if (m < 0)
+                break;
+            if (m > 0) {
+                pending_in_quote = true;
+                pos += quote_lead_symbol.size() - 1;
+            }
+            pending_fld_start = false;
+        }
+    }
+    pending.erase(0, line_start);
+    pending_scanned = pos - line_start;
+}
+
+void csv_follower::read_to_end(line_action const& action, size_t& line_count) {
+    file.clear(); // clear eof from the previous read so appended bytes are read
+    file.seekg(static_cast<std::streamoff>(follow_state.offset + pending.size()));
+    for (;;) {
+        // append the next chunk to the incomplete line from before
+        size_t const old_size = pending.size();
+        pending.resize(old_size + read_size);
+        file.read(pending.data() + old_size, read_size);
+        size_t const got = static_cast<size_t>(file.gcount());
+        pending.resize(old_size + got);
+        if (got == 0)
+            break;
+        scan_pending(action, line_count);
+    }
+}
+
+size_t csv_follower::poll(line_action const& action) {
+    size_t line_count = 0;
+    scan_pending(action, line_count); // lines left by an action that threw
+
+    std::error_code ec;
+    uint64_t const file_size = fs::file_size(path, ec);
+    uint64_t const id = file_identity(path);
+
+    // rotated or removed: finish the lines appended to the open file before moving on to a new one
+    if (file.is_open() && (ec || (id != 0 && id != follow_state.file_id)))
+        read_to_end(action, line_count);
+    if (ec)
+        return line_count; // not there (yet), e.g. between rotations
+
+    if (check_replaced(file_size)) {
+        reset();
+        check_replaced(file_size);
+    }
+    if (!file.is_open()) {
+        file.open(path, std::ios::binary);
+        if (!file.is_open())
+            return line_count;
+    }
+    read_to_end(action, line_count);
+#ifdef _WIN32
+    file.close(); // an open file can't be renamed on Windows, which would stop it being rotated
+#endif
+    return line_count;
+}
+
+bool csv_follower::wait(milliseconds timeout) {
+#ifdef __linux__
+    if (notify_fd >= 0) {
+        // events for other files in the directory don't end the wait
+        auto const   deadline = std::chrono::steady_clock::now() + timeout;
+        string const name = path.filename().string();
+        for (;;) {
+            auto const remaining = std::chrono::duration_cast<milliseconds>(deadline - std::chrono::steady_clock::now());
+            pollfd pfd{ notify_fd, POLLIN, 0 };
+            if (::poll(&pfd, 1, static_cast<int>(std::max(remaining.count(), milliseconds::rep(0)))) <= 0)
+                return false;
+
+            // drain the events, checking if any are for the followed file
+            bool changed = false;
+            alignas(inotify_event) char buf[4096];
+            ssize_t len;
+            while ((len = ::read(notify_fd, buf, sizeof(buf))) > 0) {
+                for (char* p = buf; p < buf + len; ) {
+                    auto const* ev = reinterpret_cast<inotify_event const*>(p);
+                    if ((ev->mask & IN_Q_OVERFLOW) || (ev->len > 0 && name == ev->name))
+                        changed = true; // events were lost on overflow, so it may have changed
+                    p += sizeof(inotify_event) + ev->len;
+                }
+            }
+            if (changed)
+                return true;
+        }
+    }
+#endif
+    std::this_thread::sleep_for(std::min(timeout, poll_interval));
+    return true;
+}
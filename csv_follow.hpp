@@ -0,0 +1,96 @@
+#pragma once
+#include "csv_reader.hpp"
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <chrono>
+#include <cstdint>
+
+/// <summary>
+/// Position & inferred columns of a followed file. It can be saved and given to a new csv_follower to continue
+/// where a previous one stopped.
+/// </summary>
+struct csv_follow_state {
+	uint64_t        offset = 0;     // all lines before this byte offset have been read
+	csv_name_vector col_names;      // from the header row, if has_header_row
+	csv_type_vector col_types;      // accumulated types of all lines read
+	std::string     head;           // first bytes of the file, used to detect it being replaced
+	uint64_t        file_id = 0;    // file identity (inode), when the platform has one (not Windows)
+};
+
+/// <summary>
+/// Follow a CSV file that is continuously appended to (e.g. a log), reading only the complete lines added since the
+/// last poll. The file is watched with inotify where available, otherwise by polling. If the file is truncated or
+/// replaced (rotated) it is read again from the start; the accumulated column types are kept. When the file is
+/// rotated, the lines appended to it since the last poll are read before those of the new file, except on Windows
+/// where the file isn't kept open between polls: there, lines appended just before a rotation are lost.
+///
+///   csv_follower follower(path);
+///   while (running) {
+///       follower.wait(std::chrono::seconds(1));
+///       follower.poll([](std::string_view line, csv_type_vector const& col_types) { ... });
+///   }
+/// </summary>
+class csv_follower {
+public:
+	using line_action = std::function<void(std::string_view line, csv_type_vector const& col_types)>;
+
+	csv_follower(std::filesystem::path file_path
+		, csv_flags                 follow_flags = csv_flags::header_default
+		, std::string               seps = ","
+		, std::string               quote_lead = "\""
+		, std::string               quote_trail = "\""
+		, std::string               whitesp = " \t"
+		, std::chrono::milliseconds interval = std::chrono::milliseconds(250));
+	csv_follower(const csv_follower&) = delete;
+	~csv_follower();
+
+	csv_follower& operator=(const csv_follower&) = delete;
+
+	/// <summary>
+	/// Read the complete lines appended since the last call. The types of each line are accumulated into
+	/// col_types() before action is called with it. A trailing line without a line terminator, or with an
+	/// open quote, is left until it's complete. If action throws, the lines before the one it threw on stay read
+	/// and that line is passed again by the next poll.
+	/// </summary>
+	/// <returns>The number of lines passed to action.</returns>
+	size_t poll(line_action const& action);
+
+	/// <summary>
+	/// Wait until the file may have changed, or timeout elapses.
+	/// </summary>
+	/// <returns>true if poll() may have new lines to read.</returns>
+	bool wait(std::chrono::milliseconds timeout);
+
+	csv_follow_state const& state() const { return follow_state; }
+	void                    restore(csv_follow_state const& st);
+	csv_type_vector const&  col_types() const { return follow_state.col_types; }
+	csv_name_vector const&  col_names() const { return follow_state.col_names; }
+	uint64_t                offset() const { return follow_state.offset; }
+	bool                    in_quote() const { return pending_in_quote; }
+	bool                    uses_inotify() const { return notify_fd >= 0; }
+
+private:
+	bool check_replaced(uint64_t file_size);
+	void reset();
+	void read_line(std::string_view line, line_action const& action, size_t& line_count);
+	void scan_pending(line_action const& action, size_t& line_count);
+	void read_to_end(line_action const& action, size_t& line_count);
+
+	std::filesystem::path     path;
+	csv_flags                 flags;
+	std::string               sep_charset;
+	std::string               quote_lead_symbol;
+	std::string               quote_trail_symbol;
+	std::string               whitesp_charset;
+	std::chrono::milliseconds poll_interval;
+
+	csv_follow_state follow_state;
+	std::ifstream    file;                    // file being read, kept open to finish it if it's rotated
+	std::string      pending;                 // bytes after follow_state.offset read so far, not yet a complete line
+	size_t           pending_scanned = 0;     // bytes of pending already scanned for line ends
+	bool             pending_in_quote = false; // quote state at pending_scanned
+	bool             pending_fld_start = true; // pending_scanned is at the start of a field (before any non-whitespace)
+	int              notify_fd = -1;
+	int              notify_wd = -1;
+};
@@ -6,6 +6,11 @@ int main()
     test_match_type();
     test_eval_line_types();
     test_accum_line_types();
+    test_col_stats();
+    test_spsc_ring();
+    test_pipeline_lines();
+    test_read_line_values();
+    test_csv_follower();
     std::cout << "Hello World!\n";
 }
 
@@ -9,6 +9,9 @@
 #include <type_traits>
 #include <limits>
 #include <cassert>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
 #include "util.hpp"
 
 using std::is_same_v;
@@ -133,22 +136,6 @@ csv_type smallest_float_type(const char* first, const char* last) {
     return csv_type::float64;
 }
 
-template<char_range Rng1, char_range Rng2>
-bool match_symbol(Rng1 const& line, Rng2 const& symbol) {
-    auto ln = begin(line);
-    auto sy = begin(symbol);
-    for (; ln != end(line) && sy != end(symbol) && *ln == *sy; ++ln, ++sy);
-    return ln == end(line) || sy == end(symbol);
-}
-
-template<typename CharIter>
-bool match_any_char(CharIter it, string const& charset) {
-    for (auto ch : charset)
-        if (*it == ch)
-            return true;
-    return false;
-}
-
 csv_type_vector eval_line_types( string_view const& rng
                                , string const& sep_charset
                                , string const& quote_lead_symbol
@@ -156,52 +143,150 @@ csv_type_vector eval_line_types( string_view const& rng
                                , string const& whitesp_charset
                                , csv_flags flags) {
     csv_type_vector type_vec;
+    auto eval_fld = [&](string_view fld) { type_vec.push_back(match_type(fld, flags)); };
+    parse_line(rng, sep_charset, quote_lead_symbol, quote_trail_symbol, whitesp_charset, flags, eval_fld);
+    return type_vec;
+}
 
-    // empty line
-    if (rng.empty()) {
-        type_vec.push_back(csv_type::unknown);
+csv_type_vector eval_line_types( string_view const& rng
+                               , string const& sep_charset
+                               , string const& quote_lead_symbol
+                               , string const& quote_trail_symbol
+                               , string const& whitesp_charset
+                               , csv_flags flags
+                               , csv_stats_vector& stats) {
+    csv_type_vector type_vec;
+    if (rng.empty() && (flags & csv_flags::skip_empty_lines) == csv_flags::skip_empty_lines)
         return type_vec;
-    }
+    auto eval_fld = [&](string_view fld) {
+        csv_type fld_type = match_type(fld, flags);
+        if (stats.size() <= type_vec.size())
+            stats.emplace_back();
+        stats[type_vec.size()].add(fld, fld_type);
+        type_vec.push_back(fld_type);
+    };
+    parse_line(rng, sep_charset, quote_lead_symbol, quote_trail_symbol, whitesp_charset, flags, eval_fld);
+    return type_vec;
+}
 
-    for (auto fld = begin(rng); fld != end(rng); ) {
-        // advance past leading whitespace
-        while (fld != end(rng) && match_any_char(fld, whitesp_charset)) 
-            ++fld;
+// Value of the requested type, held in place
+template<typename T>
+T& value_as(csv_value& value) {
+    if (!std::holds_alternative<T>(value))
+        value.emplace<T>();
+    return std::get<T>(value);
+}
 
-        // blank entry
-        if (fld == end(rng)) {
-            type_vec.push_back(csv_type::unknown);
-            break;
+// Read fld as a T, or T() if fld is empty. Returns false, with T(), if fld isn't a T or is out of its range.
+template<typename T>
+bool read_number(string_view fld, csv_value& value) {
+    T& num = value_as<T>(value);
+    num = T();
+    if (fld.empty())
+        return true;
+    char const* first = fld.data();
+    char const* last = fld.data() + fld.size();
+    int base = 10;
+    if constexpr (std::is_integral_v<T>) {
+        if (last - first >= 2 && first[0] == '0' && (first[1] == 'x' || first[1] == 'X')) {
+            first += 2;
+            base = 16;
         }
+    }
+    if (base == 10 && first != last && first[0] == '+')
+        ++first;
+    from_chars_result result;
+    if constexpr (std::is_integral_v<T>)
+        result = from_chars(first, last, num, base);
+    else
+        result = from_chars(first, last, num);
+    if (result.ec != std::errc() || result.ptr != last) {
+        num = T();
+        return false;
+    }
+    return true;
+}
+
+bool equal_nocase(string_view chars, string_view word) {
+    if (chars.size() != word.size())
+        return false;
+    for (size_t i = 0; i < chars.size(); ++i)
+        if ((chars[i] | 0x20) != word[i]) // word is lower case
+            return false;
+    return true;
+}
 
-        // quoted value
-        if (match_symbol(make_subrange2(fld, end(rng)), quote_lead_symbol)) {
-            fld += size(quote_lead_symbol);
-            auto first = fld;
-            for (; fld != end(rng) && !match_symbol(make_subrange2(fld, end(rng)), quote_trail_symbol); ++fld); // find trailing quote
-            type_vec.push_back(match_type(make_subrange2(first, fld), flags));
-            if (fld == end(rng)) // trailing quote not found
-                break;
-            fld += size(quote_trail_symbol); // advance past quote
-
-            for (; fld != end(rng) && !match_any_char(fld, sep_charset); ++fld); // advance to next sep_charset or eol
-            if (fld != end(rng)) // move to start of next fld
-                ++fld;
+// Read fld as a value of col_type, or the type's default if fld is empty. Returns false, with the default, if fld
+// can't be converted to col_type.
+bool read_value(string_view fld, csv_type col_type, csv_value& value) {
+    switch (col_type) {
+    case csv_type::boolean: {
+        bool& val = value_as<bool>(value);
+        val = false;
+        if (fld.empty() || equal_nocase(fld, "false") || equal_nocase(fld, "no"))
+            return true;
+        if (equal_nocase(fld, "true") || equal_nocase(fld, "yes")) {
+            val = true;
+            return true;
         }
-        // unquoted value
-        else {
-            auto first = fld;
-            auto last = fld;
-            for (; fld != end(rng) && !match_any_char(fld, sep_charset); ++fld) {
-                if (!match_any_char(fld, whitesp_charset))
-                    last = fld + 1;
+        int64_t ival = 0;
+        from_chars_result result = from_chars(fld.data(), fld.data() + fld.size(), ival);
+        if (result.ec != std::errc() || result.ptr != fld.data() + fld.size())
+            return false;
+        val = ival != 0;
+        return true;
+    }
+    case csv_type::int8:    return read_number<int8_t>(fld, value);
+    case csv_type::uint8:   return read_number<uint8_t>(fld, value);
+    case csv_type::int16:   return read_number<int16_t>(fld, value);
+    case csv_type::uint16:  return read_number<uint16_t>(fld, value);
+    case csv_type::int32:   return read_number<int32_t>(fld, value);
+    case csv_type::uint32:  return read_number<uint32_t>(fld, value);
+    case csv_type::int64:   return read_number<int64_t>(fld, value);
+    case csv_type::uint64:  return read_number<uint64_t>(fld, value);
+    case csv_type::float32: return read_number<float>(fld, value);
+    case csv_type::float64: return read_number<double>(fld, value);
+    case csv_type::float80: return read_number<long double>(fld, value);
+    default:                value_as<string>(value).assign(fld.data(), fld.size()); return true;
+    }
+}
+
+csv_type col_type_at(csv_type_vector const& col_types, size_t col) {
+    return col < col_types.size() ? col_types[col] : csv_type::string;
+}
+
+csv_line_read read_line_values( string_view const& rng
+                              , string const& sep_charset
+                              , string const& quote_lead_symbol
+                              , string const& quote_trail_symbol
+                              , string const& whitesp_charset
+                              , csv_flags flags
+                              , csv_type_vector const& col_types
+                              , csv_value_vector& values) {
+    bool const fixed_count = (flags & csv_flags::allow_only_fixed_column_count) == csv_flags::allow_only_fixed_column_count;
+    if (fixed_count && values.size() != col_types.size())
+        values.resize(col_types.size());
+
+    csv_line_read result;
+    size_t&       col = result.field_count;
+    auto read_fld = [&](string_view fld) {
+        if (col >= values.size()) {
+            if (fixed_count) {
+                ++col; // ignore extra fields
+                return;
             }
-            type_vec.push_back(match_type(make_subrange2(first, last), flags));
-            if (fld != end(rng)) // move to start of next fld
-                ++fld;
+            values.emplace_back();
         }
-    }
-    return type_vec;
+        if (!read_value(fld, col_type_at(col_types, col), values[col]) && result.failed_count++ == 0)
+            result.first_failed = col;
+        ++col;
+    };
+    parse_line(rng, sep_charset, quote_lead_symbol, quote_trail_symbol, whitesp_charset, flags, read_fld);
+
+    // missing fields
+    for (size_t i = col; i < values.size(); ++i)
+        read_value(string_view(), col_type_at(col_types, i), values[i]);
+    return result;
 }
 
 int sint_bits(csv_type ct) {
@@ -252,74 +337,265 @@ csv_type make_uint(int bits) {
     }
 }
 
-void accum_line_types(csv_type_vector& accum_types, csv_type_vector const& line_types) {
-    for (size_t i = 0; i < std::min(accum_types.size(), line_types.size()); ++i) {
-        csv_type const afld = accum_types[i];
-        csv_type const lfld = line_types[i];
-        if (is_int(afld)) {
-            if (is_int(lfld)) {
-                // larger signed int?
-                if (is_sint(afld) && is_sint(lfld)) {
-                    if (sint_bits(afld) < sint_bits(lfld))
-                        accum_types[i] = lfld;
-                }
-                // larger unsigned int?
-                else if (is_uint(afld) && is_uint(lfld)) {
-                    if (uint_bits(afld) < uint_bits(lfld))
-                        accum_types[i] = lfld;
-                }
-                // mixed signed & unsigned
-                else {
-                    // make it signed, with enough bits for both
-                    accum_types[i] = make_sint(std::max(sint_bits(afld), uint_bits(lfld)));
-                }
-            }
-            else if (is_boolean(lfld)) {
-                accum_types[i] = csv_type::string;
+// Common type that will hold values of both afld and lfld
+csv_type accum_type(csv_type afld, csv_type lfld) {
+    if (is_int(afld)) {
+        if (is_int(lfld)) {
+            // larger signed int?
+            if (is_sint(afld) && is_sint(lfld)) {
+                if (sint_bits(afld) < sint_bits(lfld))
+                    return lfld;
             }
-            else if (is_float(lfld)) {
-                accum_types[i] = lfld; // float overrides int
-            }
-            else if (is_string(lfld)) {
-                accum_types[i] = lfld; // string overrides int
-            }
-            else if (is_unknown(lfld)) {
-                // leave as-is
+            // larger unsigned int?
+            else if (is_uint(afld) && is_uint(lfld)) {
+                if (uint_bits(afld) < uint_bits(lfld))
+                    return lfld;
             }
+            // mixed signed & unsigned
             else {
-                assert(false); // unexpected
+                // make it signed, with enough bits for both
+                return make_sint(std::max(sint_bits(afld), uint_bits(lfld)));
             }
         }
-        else if (is_boolean(afld)) {
-            if (is_boolean(lfld) || is_unknown(lfld)) {
-                // leave as-is
-            }
-            else {
-                accum_types[i] = csv_type::string;
-            }
+        else if (is_boolean(lfld)) {
+            return csv_type::string;
         }
-        else if (is_float(afld)) {
-            if (is_string(lfld))
-                accum_types[i] = lfld; // string overrides float
-            else if (is_boolean(lfld))
-                accum_types[i] = csv_type::string;
+        else if (is_float(lfld)) {
+            return lfld; // float overrides int
         }
-        else if (is_string(afld)) {
-            // once a string, always a string
+        else if (is_string(lfld)) {
+            return lfld; // string overrides int
         }
-        else if (is_unknown(afld)) {
-            accum_types[i] = lfld;
+        else if (is_unknown(lfld)) {
+            // leave as-is
         }
         else {
             assert(false); // unexpected
         }
     }
+    else if (is_boolean(afld)) {
+        if (is_boolean(lfld) || is_unknown(lfld)) {
+            // leave as-is
+        }
+        else {
+            return csv_type::string;
+        }
+    }
+    else if (is_float(afld)) {
+        if (is_string(lfld))
+            return lfld; // string overrides float
+        else if (is_boolean(lfld))
+            return csv_type::string;
+    }
+    else if (is_string(afld)) {
+        // once a string, always a string
+    }
+    else if (is_unknown(afld)) {
+        return lfld;
+    }
+    else {
+        assert(false); // unexpected
+    }
+    return afld;
+}
+
+void accum_line_types(csv_type_vector& accum_types, csv_type_vector const& line_types) {
+    for (size_t i = 0; i < std::min(accum_types.size(), line_types.size()); ++i)
+        accum_types[i] = accum_type(accum_types[i], line_types[i]);
 
     // append new columns, if any
     for (size_t i = accum_types.size(); i < line_types.size(); ++i)
         accum_types.push_back(line_types[i]);
 }
 
+// 64-bit FNV-1a, followed by a splitmix64 finalizer so the low bits used to select HLL registers are well mixed
+uint64_t hash_value(string_view value) {
+    uint64_t h = 14695981039346656037ull;
+    for (unsigned char ch : value) {
+        h ^= ch;
+        h *= 1099511628211ull;
+    }
+    h ^= h >> 30;
+    h *= 0xbf58476d1ce4e5b9ull;
+    h ^= h >> 27;
+    h *= 0x94d049bb133111ebull;
+    h ^= h >> 31;
+    return h;
+}
+
+void csv_hll::add(string_view value) {
+    uint64_t const h = hash_value(value);
+    size_t const   idx = static_cast<size_t>(h & (register_count - 1));
+    uint64_t const rest = h >> precision;
+    // rank = position of the first 1-bit in the remaining 64-precision bits
+    uint8_t rank = 1;
+    for (uint64_t bit = 1; rank <= 64 - precision && !(rest & bit); bit <<= 1)
+        ++rank;
+    registers[idx] = std::max(registers[idx], rank);
+}
+
+void csv_hll::merge(csv_hll const& other) {
+    for (size_t i = 0; i < register_count; ++i)
+        registers[i] = std::max(registers[i], other.registers[i]);
+}
+
+double csv_hll::estimate() const {
+    double const m = static_cast<double>(register_count);
+    double       inv_sum = 0.0;
+    size_t       zeros = 0;
+    for (uint8_t r : registers) {
+        inv_sum += std::ldexp(1.0, -r);
+        if (r == 0)
+            ++zeros;
+    }
+    double const alpha = 0.7213 / (1.0 + 1.079 / m);
+    double const raw = alpha * m * m / inv_sum;
+    // linear counting is more accurate for small cardinalities
+    if (raw <= 2.5 * m && zeros > 0)
+        return m * std::log(m / static_cast<double>(zeros));
+    return raw;
+}
+
+// Numeric value of a field that was matched as value_type, if it has one
+bool value_number(string_view value, csv_type value_type, double& num) {
+    char const* first = value.data();
+    char const* last = value.data() + value.size();
+    if (is_boolean(value_type)) {
+        num = (first[0] == 'T' || first[0] == 't' || first[0] == 'Y' || first[0] == 'y') ? 1.0 : 0.0;
+        return true;
+    }
+    if (is_int(value_type)) {
+        if (last - first >= 2 && first[0] == '0' && (first[1] == 'x' || first[1] == 'X')) {
+            uint64_t val;
+            if (from_chars(first + 2, last, val, 16).ptr != last)
+                return false;
+            num = static_cast<double>(val);
+            return true;
+        }
+        if (first[0] == '+')
+            ++first;
+        int64_t sval = 0;
+        if (from_chars(first, last, sval).ptr == last) {
+            num = static_cast<double>(sval);
+            return true;
+        }
+        uint64_t uval = 0;
+        if (from_chars(first, last, uval).ptr == last) {
+            num = static_cast<double>(uval);
+            return true;
+        }
+        return false;
+    }
+    if (is_float(value_type)) {
+        if (first[0] == '+')
+            ++first;
+        return from_chars(first, last, num).ptr == last;
+    }
+    return false;
+}
+
+// Key of a field that was matched as value_type, so equal numbers have the same key however they're written
+// (1, +1, 01, 0x01, 1.0). Integers are keyed by their exact 64-bit value; non-integral floats by their bits.
+string_view value_key(string_view value, csv_type value_type, char (&key)[9]) {
+    char const* first = value.data();
+    char const* last = value.data() + value.size();
+    int64_t  ival = 0;
+    uint64_t uval = 0;
+    bool     is_uval = false; // value above the int64 range
+    if (is_boolean(value_type)) {
+        ival = (first[0] == 'T' || first[0] == 't' || first[0] == 'Y' || first[0] == 'y') ? 1 : 0;
+    }
+    else if (is_int(value_type)) {
+        if (last - first >= 2 && first[0] == '0' && (first[1] == 'x' || first[1] == 'X')) {
+            if (from_chars(first + 2, last, uval, 16).ptr != last)
+                return value;
+            is_uval = uval > static_cast<uint64_t>(numeric_limits<int64_t>::max());
+            ival = static_cast<int64_t>(uval);
+        }
+        else {
+            if (first[0] == '+')
+                ++first;
+            if (from_chars(first, last, ival).ptr != last) {
+                if (from_chars(first, last, uval).ptr != last)
+                    return value;
+                is_uval = true;
+            }
+        }
+    }
+    else if (is_float(value_type)) {
+        if (first[0] == '+')
+            ++first;
+        double num = 0.0;
+        if (from_chars(first, last, num).ptr != last)
+            return value;
+        if (num >= -0x1p63 && num < 0x1p63 && num == std::trunc(num)) {
+            ival = static_cast<int64_t>(num); // integral: same key as the integer
+        }
+        else {
+            std::memcpy(key, &num, sizeof(num));
+            key[8] = 2;
+            return string_view(key, sizeof(key));
+        }
+    }
+    else {
+        return value;
+    }
+    if (is_uval)
+        std::memcpy(key, &uval, sizeof(uval));
+    else
+        std::memcpy(key, &ival, sizeof(ival));
+    key[8] = is_uval ? 1 : 0;
+    return string_view(key, sizeof(key));
+}
+
+void csv_col_stats::add(string_view value, csv_type value_type) {
+    if (is_unknown(value_type)) {
+        ++empty_count;
+        return;
+    }
+    ++value_count;
+    type = accum_type(type, value_type);
+    min_length = std::min(min_length, value.size());
+    max_length = std::max(max_length, value.size());
+
+    // distinct by value while the column is numeric or boolean, by text once it's a string
+    char key[9];
+    distinct.add(value_key(value, value_type, key));
+    distinct_text.add(value);
+
+    double num;
+    if (value_number(value, value_type, num) && std::isfinite(num)) {
+        ++number_count;
+        min = std::min(min, num);
+        max = std::max(max, num);
+        sum += num;
+        if (is_boolean(value_type) && num != 0.0)
+            ++true_count;
+    }
+}
+
+void csv_col_stats::merge(csv_col_stats const& other) {
+    type = accum_type(type, other.type);
+    value_count += other.value_count;
+    empty_count += other.empty_count;
+    number_count += other.number_count;
+    min = std::min(min, other.min);
+    max = std::max(max, other.max);
+    sum += other.sum;
+    true_count += other.true_count;
+    min_length = std::min(min_length, other.min_length);
+    max_length = std::max(max_length, other.max_length);
+    distinct.merge(other.distinct);
+    distinct_text.merge(other.distinct_text);
+}
+
+void accum_col_stats(csv_stats_vector& accum_stats, csv_stats_vector const& other_stats) {
+    if (accum_stats.size() < other_stats.size())
+        accum_stats.resize(other_stats.size());
+    for (size_t i = 0; i < other_stats.size(); ++i)
+        accum_stats[i].merge(other_stats[i]);
+}
+
 // Run program: Ctrl + F5 or Debug > Start Without Debugging menu
 // Debug program: F5 or Debug > Start Debugging menu
 
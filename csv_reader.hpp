@@ -4,7 +4,15 @@
 #include <string>
 #include <string_view>
 #include <vector>
+#include <array>
+#include <limits>
+#include <cstdint>
 #include <ranges>
+#include <span>
+#include <thread>
+#include <exception>
+#include "util.hpp"
+#include "spsc_ring.hpp"
 
 template<typename Rng>
 concept char_range = std::ranges::random_access_range<Rng> && std::is_same_v<std::ranges::range_value_t<Rng>, char>;
@@ -22,6 +30,48 @@ using csv_type_vector = std::vector<csv_type>;
 using csv_name = std::string;
 using csv_name_vector = std::vector<csv_name>;
 
+/// <summary>
+/// HyperLogLog sketch used to estimate the number of distinct values in a column. Sketches built
+/// over different chunks of a file can be merged to estimate the distinct count of the whole file.
+/// </summary>
+struct csv_hll {
+	static constexpr int    precision = 12;
+	static constexpr size_t register_count = size_t(1) << precision;
+
+	std::array<uint8_t, register_count> registers{};
+
+	void   add(std::string_view value);
+	void   merge(csv_hll const& other);
+	double estimate() const;
+};
+
+/// <summary>
+/// Statistics for a single column, accumulated while the lines are parsed. Which members are meaningful
+/// depends on the column type: min/max/mean for integer & floating point, true_count for boolean and
+/// min_length/max_length for string. min/max/mean only include the values that could be read as a finite number.
+/// Distinct values are counted by value while the column is numeric or boolean and by text once it is a string.
+/// </summary>
+struct csv_col_stats {
+	csv_type type = csv_type::unknown; // common type of the non-empty values
+	size_t   value_count = 0;          // non-empty values
+	size_t   empty_count = 0;          // empty (or blank) values
+	size_t   number_count = 0;         // values included in min, max & sum (nan & inf are not)
+	double   min = std::numeric_limits<double>::infinity();
+	double   max = -std::numeric_limits<double>::infinity();
+	double   sum = 0.0;
+	size_t   true_count = 0;
+	size_t   min_length = std::numeric_limits<size_t>::max();
+	size_t   max_length = 0;
+	csv_hll  distinct;                 // by value, e.g. 1 & 0x01 are the same
+	csv_hll  distinct_text;            // by text, used once the column is a string
+
+	void   add(std::string_view value, csv_type value_type);
+	void   merge(csv_col_stats const& other);
+	double mean() const { return number_count ? sum / static_cast<double>(number_count) : 0.0; }
+	double distinct_count() const { return type == csv_type::string ? distinct_text.estimate() : distinct.estimate(); }
+};
+using csv_stats_vector = std::vector<csv_col_stats>;
+
 /// <summary>
 /// Descriptor of the CSV file contents that the user can provide.
 /// </summary>
@@ -65,6 +115,13 @@ csv_type smallest_float_type(const char* first, const char* last);
 /// <param name="line_types">The new set of types to accumulate into accum_types.</param>
 void accum_line_types(csv_type_vector& accum_types, csv_type_vector const& line_types);
 
+/// <summary>
+/// Accumulate the column statistics from two sets of lines (e.g. chunks parsed in parallel) into one.
+/// </summary>
+/// <param name="accum_stats">The accumulated statistics so far.</param>
+/// <param name="other_stats">The statistics to merge into accum_stats.</param>
+void accum_col_stats(csv_stats_vector& accum_stats, csv_stats_vector const& other_stats);
+
 /// <summary>
 /// Classify a character range as one of the types defined in csv_value enum.
 /// </summary>
@@ -125,15 +182,79 @@ auto match_type(Rng const& chars, csv_flags flags) -> csv_type {
 
 // LineRange: *iterator = string_view
 
+template<char_range Rng1, char_range Rng2>
+bool match_symbol(Rng1 const& line, Rng2 const& symbol) {
+	auto ln = std::ranges::begin(line);
+	auto sy = std::ranges::begin(symbol);
+	for (; ln != std::ranges::end(line) && sy != std::ranges::end(symbol) && *ln == *sy; ++ln, ++sy);
+	return ln == std::ranges::end(line) || sy == std::ranges::end(symbol);
+}
+
+template<typename CharIter>
+bool match_any_char(CharIter it, std::string const& charset) {
+	for (auto ch : charset)
+		if (*it == ch)
+			return true;
+	return false;
+}
+
+/// <summary>
+/// Split a line into its fields, calling action(std::string_view) for each one. Quoted values are passed
+/// without their quotes and unquoted values without leading/trailing whitespace. An empty line, or a blank
+/// last field (including one after a trailing separator), is passed as an empty value.
+/// </summary>
 template<typename Fnc>
 void parse_line(std::string_view const& rng
 	, std::string const& sep_charset
 	, std::string const& quote_lead_symbol
 	, std::string const& quote_trail_symbol
 	, std::string const& whitesp_charset
-	, csv_flags          flags
+	, [[maybe_unused]] csv_flags flags
 	, Fnc& action) {
+	// empty line
+	if (rng.empty()) {
+		action(rng);
+		return;
+	}
+
+	for (auto fld = rng.begin(); fld != rng.end(); ) {
+		// advance past leading whitespace
+		while (fld != rng.end() && match_any_char(fld, whitesp_charset))
+			++fld;
+
+		// blank entry
+		if (fld == rng.end()) {
+			action(std::string_view());
+			break;
+		}
 
+		// quoted value
+		if (match_symbol(make_subrange2(fld, rng.end()), quote_lead_symbol)) {
+			fld += quote_lead_symbol.size();
+			auto first = fld;
+			for (; fld != rng.end() && !match_symbol(make_subrange2(fld, rng.end()), quote_trail_symbol); ++fld); // find trailing quote
+			action(std::string_view(first, fld));
+			if (fld == rng.end()) // trailing quote not found
+				break;
+			fld += quote_trail_symbol.size(); // advance past quote
+
+			for (; fld != rng.end() && !match_any_char(fld, sep_charset); ++fld); // advance to next sep_charset or eol
+			if (fld != rng.end() && ++fld == rng.end()) // move to start of next fld
+				action(std::string_view()); // separator at end of line: empty last field
+		}
+		// unquoted value
+		else {
+			auto first = fld;
+			auto last = fld;
+			for (; fld != rng.end() && !match_any_char(fld, sep_charset); ++fld) {
+				if (!match_any_char(fld, whitesp_charset))
+					last = fld + 1;
+			}
+			action(std::string_view(first, last));
+			if (fld != rng.end() && ++fld == rng.end()) // move to start of next fld
+				action(std::string_view()); // separator at end of line: empty last field
+		}
+	}
 }
 
 csv_type_vector eval_line_types(std::string_view const& rng
@@ -143,6 +264,49 @@ csv_type_vector eval_line_types(std::string_view const& rng
 	, std::string const& whitesp_charset
 	, csv_flags          flags);
 
+/// <summary>
+/// Evaluate the types of a line, the same as eval_line_types, while adding each field to the statistics of
+/// its column in the same pass. stats is grown to hold any new columns. With skip_empty_lines an empty line
+/// isn't added to the stats and no types are returned for it.
+/// </summary>
+csv_type_vector eval_line_types(std::string_view const& rng
+	, std::string const& sep_charset
+	, std::string const& quote_lead_symbol
+	, std::string const& quote_trail_symbol
+	, std::string const& whitesp_charset
+	, csv_flags          flags
+	, csv_stats_vector&  stats);
+
+
+/// <summary>
+/// Outcome of read_line_values.
+/// </summary>
+struct csv_line_read {
+	size_t field_count = 0;  // fields in the line
+	size_t failed_count = 0; // fields that couldn't be converted to their column type (e.g. out of range) and were
+	                         // assigned the type's default instead
+	size_t first_failed = 0; // column of the first failed field, if failed_count > 0
+};
+
+/// <summary>
+/// Read the values of a line into values, converting each field to the type of its column. values is overwritten
+/// in place: a value that already holds its column's type is assigned to directly, so string capacity is reused and,
+/// once warmed up, reading a line doesn't allocate. Empty fields are assigned the default of their type.
+/// </summary>
+/// <param name="col_types">Column types. Fields beyond the last column are read as strings.</param>
+/// <param name="values">Values of the previous line, to be overwritten. With allow_only_fixed_column_count it always
+/// holds col_types.size() values and extra fields are ignored. Otherwise it grows to the most fields seen in a line but
+/// never shrinks; values beyond the fields of this line are reset to their defaults.</param>
+/// <returns>The number of fields in the line, and of those that couldn't be converted to their column's type. A failed
+/// field usually means the column's type, e.g. from a prescan, needs to be widened.</returns>
+csv_line_read read_line_values(std::string_view const& rng
+	, std::string const&     sep_charset
+	, std::string const&     quote_lead_symbol
+	, std::string const&     quote_trail_symbol
+	, std::string const&     whitesp_charset
+	, csv_flags              flags
+	, csv_type_vector const& col_types
+	, csv_value_vector&      values);
 
 template<std::ranges::forward_range LineRange, typename ColsOutIter>
 std::pair< csv_name_vector, csv_type_vector> sample_lines(const LineRange& lines, int max_lines, csv_flags flags) {
@@ -163,6 +327,81 @@ struct csv_row {
 	csv_row& operator=(const csv_row&) = default;
 };
 
+/// <summary>
+/// Options for pipeline_lines.
+/// </summary>
+struct csv_pipeline_options {
+	size_t batch_size = 256;  // rows published to the consumer at a time
+	size_t batch_count = 8;   // batches in flight between the parsing thread and the consumer
+	size_t spin_count = 1000; // times a waiting thread polls before it parks
+};
+
+/// <summary>
+/// Parse lines on a separate thread while the calling thread consumes the rows, so a slow consumer overlaps with
+/// parsing instead of stalling it. Rows are published in batches through a lock-free single-producer/single-consumer
+/// ring; consumed batches are handed back to the parser and their rows overwritten, reusing their capacity.
+/// An exception thrown by parse or consume stops both sides and is rethrown on the calling thread.
+/// </summary>
+/// <param name="lines">Lines to parse; *iterator must be convertible to std::string_view.</param>
+/// <param name="parse">bool parse(std::string_view line, Row& row), called on the parsing thread. Fills row
+/// from line, returning false if the line should be skipped.</param>
+/// <param name="consume">void consume(std::span&lt;Row&gt; rows), called on the calling thread for each batch in line order.</param>
+template<typename Row, std::ranges::forward_range LineRange, typename ParseFnc, typename ConsumeFnc>
+void pipeline_lines(const LineRange& lines, ParseFnc parse, ConsumeFnc consume, csv_pipeline_options const& opts = {}) {
+	struct row_batch {
+		std::vector<Row> rows;
+		size_t           count = 0;
+	};
+	size_t const           batch_size = std::max<size_t>(opts.batch_size, 1);
+	std::vector<row_batch> batches(std::max<size_t>(opts.batch_count, 1));
+	spsc_ring<size_t>      full_batches(batches.size(), opts.spin_count);  // parser -> consumer
+	spsc_ring<size_t>      empty_batches(batches.size(), opts.spin_count); // consumer -> parser
+	for (size_t i = 0; i < batches.size(); ++i)
+		empty_batches.try_push(size_t(i));
+
+	std::exception_ptr parse_error;
+	std::thread parser([&] {
+		try {
+			auto it = std::ranges::begin(lines);
+			auto last = std::ranges::end(lines);
+			size_t idx = 0;
+			while (it != last && empty_batches.pop(idx)) {
+				row_batch& batch = batches[idx];
+				if (batch.rows.size() < batch_size)
+					batch.rows.resize(batch_size);
+				for (batch.count = 0; it != last && batch.count < batch_size; ++it)
+					if (parse(std::string_view(*it), batch.rows[batch.count]))
+						++batch.count;
+				if (!full_batches.push(std::move(idx)))
+					break; // consumer stopped
+			}
+		}
+		catch (...) {
+			parse_error = std::current_exception();
+		}
+		full_batches.close();
+	});
+
+	try {
+		size_t idx = 0;
+		while (full_batches.pop(idx)) {
+			row_batch& batch = batches[idx];
+			if (batch.count > 0)
+				consume(std::span<Row>(batch.rows.data(), batch.count));
+			empty_batches.push(std::move(idx));
+		}
+	}
+	catch (...) {
+		full_batches.close();
+		empty_batches.close();
+		parser.join();
+		throw;
+	}
+	parser.join();
+	if (parse_error)
+		std::rethrow_exception(parse_error);
+}
+
 template<std::ranges::forward_range LineRange, typename ColsOutIter>
 requires std::output_iterator<ColsOutIter, csv_row>
 auto csv_reader(const LineRange& lines, ColsOutIter cols, int prescan_lines = 100, csv_flags flags = csv_flags::defaults) {
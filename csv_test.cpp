@@ -1,5 +1,12 @@
 #include "csv_test.hpp"
+#include "csv_follow.hpp"
 #include <cassert>
+#include <cmath>
+#include <thread>
+#include <chrono>
+#include <stdexcept>
+#include <fstream>
+#include <filesystem>
 
 using namespace std::literals;
 
@@ -34,6 +41,7 @@ void test_eval_line_types() {
     assert(eval_line_types("123", sep_charset, qlead_sym, qtrail_sym, ws_charset, flags) == csv_type_vector{ csv_type::int8 });
     assert(eval_line_types("3.", sep_charset, qlead_sym, qtrail_sym, ws_charset, flags) == csv_type_vector{ csv_type::float64 });
     assert(eval_line_types("0xffff", sep_charset, qlead_sym, qtrail_sym, ws_charset, flags) == csv_type_vector{ csv_type::uint16 });
+    assert(eval_line_types("1,", sep_charset, qlead_sym, qtrail_sym, ws_charset, flags) == (csv_type_vector{ csv_type::int8, csv_type::unknown }));
 
     csv_type_vector ctv1{ csv_type::int8,csv_type::float64, csv_type::string, csv_type::uint8 };
     assert(eval_line_types("1, 2.3, \"abc\", 0x00", sep_charset, qlead_sym, qtrail_sym, ws_charset, flags) == ctv1);
@@ -168,3 +176,348 @@ void test_accum_line_types() {
     assert(a20 == x20);
 }
 
+
+void test_col_stats() {
+    string const sep_charset = ",";
+    string const qlead_sym = "\"";
+    string const qtrail_sym = "\"";
+    string const ws_charset = " \t";
+    csv_flags flags = csv_flags::detect_true_false_bool | csv_flags::detect_yes_no_bool;
+
+    // stats accumulated in the same pass as the types
+    csv_stats_vector stats;
+    csv_type_vector ctv1{ csv_type::int8, csv_type::float64, csv_type::string, csv_type::boolean };
+    assert(eval_line_types("1, 2.5, \"abc\", true", sep_charset, qlead_sym, qtrail_sym, ws_charset, flags, stats) == ctv1);
+    eval_line_types("-3, , \"x\", false", sep_charset, qlead_sym, qtrail_sym, ws_charset, flags, stats);
+    eval_line_types("0x10, 4.5, \"abcd\", TRUE", sep_charset, qlead_sym, qtrail_sym, ws_charset, flags, stats);
+    assert(stats.size() == 4);
+
+    assert(stats[0].type == csv_type::int8);
+    assert(stats[0].value_count == 3 && stats[0].empty_count == 0);
+    assert(stats[0].min == -3.0 && stats[0].max == 16.0 && stats[0].mean() == 14.0 / 3.0);
+
+    assert(stats[1].type == csv_type::float64);
+    assert(stats[1].value_count == 2 && stats[1].empty_count == 1);
+    assert(stats[1].min == 2.5 && stats[1].max == 4.5 && stats[1].mean() == 3.5);
+
+    assert(stats[2].type == csv_type::string);
+    assert(stats[2].min_length == 1 && stats[2].max_length == 4);
+
+    assert(stats[3].type == csv_type::boolean);
+    assert(stats[3].true_count == 2);
+
+    // empty counts are exact: skipped empty lines aren't counted, a trailing empty field is
+    csv_stats_vector empty_stats;
+    for (auto line : { "1,2"s, ""s, ""s, "3,4,"s, "5,,6"s })
+        eval_line_types(line, sep_charset, qlead_sym, qtrail_sym, ws_charset, flags | csv_flags::skip_empty_lines, empty_stats);
+    assert(empty_stats.size() == 3);
+    assert(empty_stats[0].empty_count == 0 && empty_stats[0].value_count == 3);
+    assert(empty_stats[1].empty_count == 1 && empty_stats[1].value_count == 2);
+    assert(empty_stats[2].empty_count == 1 && empty_stats[2].value_count == 1);
+
+    // merging stats of separate chunks gives the same result as one pass over all of them
+    csv_stats_vector chunk1, chunk2, all;
+    for (int i = 0; i < 1000; ++i) {
+        string const line = std::to_string(i % 500) + "," + std::to_string(i);
+        eval_line_types(line, sep_charset, qlead_sym, qtrail_sym, ws_charset, flags, i < 600 ? chunk1 : chunk2);
+        eval_line_types(line, sep_charset, qlead_sym, qtrail_sym, ws_charset, flags, all);
+    }
+    accum_col_stats(chunk1, chunk2);
+    for (size_t i = 0; i < all.size(); ++i) {
+        assert(chunk1[i].type == all[i].type);
+        assert(chunk1[i].value_count == all[i].value_count);
+        assert(chunk1[i].min == all[i].min && chunk1[i].max == all[i].max && chunk1[i].sum == all[i].sum);
+        assert(chunk1[i].distinct.registers == all[i].distinct.registers);
+    }
+
+    // numbers are distinct by value, not by text; non-finite values are left out of min/max/mean
+    csv_stats_vector num_stats;
+    for (auto line : { "1, abc, true, 1.5"s, "+1, abc, TRUE, nan"s, "01, ABC, true, 2.5"s, "0x01, abc, True, inf"s })
+        eval_line_types(line, sep_charset, qlead_sym, qtrail_sym, ws_charset, flags, num_stats);
+    assert(num_stats[0].min == 1.0 && num_stats[0].max == 1.0);
+    assert(std::round(num_stats[0].distinct_count()) == 1.0);
+    assert(std::round(num_stats[1].distinct_count()) == 2.0);
+    assert(std::round(num_stats[2].distinct_count()) == 1.0);
+    assert(num_stats[3].type == csv_type::float64 && num_stats[3].value_count == 4);
+    assert(num_stats[3].number_count == 2 && num_stats[3].mean() == 2.0 && num_stats[3].max == 2.5);
+
+    // large integer ids are distinct by their exact value; a column that becomes a string is distinct by text
+    csv_stats_vector id_stats;
+    for (int i = 0; i < 1000; ++i)
+        eval_line_types(std::to_string(1000000000000000000ll + i) + ", " + (i % 2 ? "01" : "1"), sep_charset, qlead_sym, qtrail_sym, ws_charset, flags, id_stats);
+    eval_line_types("1000000000000000000, abc", sep_charset, qlead_sym, qtrail_sym, ws_charset, flags, id_stats);
+    assert(id_stats[0].type == csv_type::int64);
+    assert(std::abs(id_stats[0].distinct_count() - 1000.0) < 50.0);
+    assert(id_stats[1].type == csv_type::string);
+    assert(std::round(id_stats[1].distinct_count()) == 3.0);
+
+    // distinct estimates within a few percent
+    assert(std::abs(all[0].distinct_count() - 500.0) < 25.0);
+    assert(std::abs(all[1].distinct_count() - 1000.0) < 50.0);
+}
+
+void test_spsc_ring() {
+    spsc_ring<int> ring(3);
+    assert(ring.capacity() == 4);
+    int val = 0;
+    assert(!ring.try_pop(val));
+    for (int i = 0; i < 4; ++i)
+        assert(ring.try_push(int(i)));
+    assert(!ring.try_push(4)); // full
+    assert(ring.try_pop(val) && val == 0);
+    assert(ring.try_push(4));
+
+    // values pushed before close can still be popped
+    ring.close();
+    assert(!ring.push(5));
+    for (int i = 1; i <= 4; ++i)
+        assert(ring.pop(val) && val == i);
+    assert(!ring.pop(val));
+
+    // producer & consumer on different threads, parking when the ring is full or empty
+    spsc_ring<int> ring2(8, 10);
+    int const count = 100000;
+    std::thread producer([&] {
+        for (int i = 0; i < count; ++i)
+            ring2.push(int(i));
+        ring2.close();
+    });
+    int expect = 0;
+    while (ring2.pop(val))
+        assert(val == expect++);
+    producer.join();
+    assert(expect == count);
+}
+
+void test_pipeline_lines() {
+    string const sep_charset = ",";
+    string const qlead_sym = "\"";
+    string const qtrail_sym = "\"";
+    string const ws_charset = " \t";
+    csv_flags flags = csv_flags::detect_true_false_bool;
+
+    std::vector<string> lines;
+    for (int i = 0; i < 5000; ++i)
+        lines.push_back(i % 10 == 0 ? ""s : std::to_string(i) + ", " + std::to_string(i) + ".5, abc");
+
+    auto parse = [&](std::string_view line, csv_type_vector& row) {
+        if (line.empty())
+            return false; // skip empty lines
+        row = eval_line_types(line, sep_charset, qlead_sym, qtrail_sym, ws_charset, flags);
+        return true;
+    };
+
+    // slow consumer: rows arrive in batches, in order, with the skipped lines removed
+    size_t rows = 0;
+    size_t batches = 0;
+    csv_type_vector accum_types;
+    auto consume = [&](std::span<csv_type_vector> batch) {
+        assert(batch.size() <= 64);
+        for (auto& row : batch)
+            accum_line_types(accum_types, row);
+        rows += batch.size();
+        if (++batches % 10 == 0)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    };
+    pipeline_lines<csv_type_vector>(lines, parse, consume, csv_pipeline_options{ 64, 4, 100 });
+    assert(rows == 4500);
+    assert(accum_types == (csv_type_vector{ csv_type::int16, csv_type::float64, csv_type::string }));
+
+    // errors on either side are rethrown on the calling thread
+    bool thrown = false;
+    try {
+        pipeline_lines<csv_type_vector>(lines, [&](std::string_view line, csv_type_vector& row) {
+            if (line == "2501, 2501.5, abc")
+                throw std::runtime_error("parse");
+            return parse(line, row);
+        }, [](std::span<csv_type_vector>) {});
+    }
+    catch (std::runtime_error const&) {
+        thrown = true;
+    }
+    assert(thrown);
+
+    thrown = false;
+    try {
+        pipeline_lines<csv_type_vector>(lines, parse, [](std::span<csv_type_vector>) { throw std::runtime_error("consume"); });
+    }
+    catch (std::runtime_error const&) {
+        thrown = true;
+    }
+    assert(thrown);
+}
+
+void test_read_line_values() {
+    string const sep_charset = ",";
+    string const qlead_sym = "\"";
+    string const qtrail_sym = "\"";
+    string const ws_charset = " \t";
+    csv_flags flags = csv_flags::detect_true_false_bool | csv_flags::allow_only_fixed_column_count;
+    csv_type_vector const types{ csv_type::int32, csv_type::float64, csv_type::string, csv_type::boolean, csv_type::uint16 };
+    csv_name_vector const names{ "id", "val", "desc", "flag", "code" };
+
+    // values converted to their column types; missing & empty fields get defaults, extra fields are ignored
+    csv_value_vector values;
+    csv_row row(names, types, values);
+    assert(read_line_values("-12, 2.5, \"a description\", true, 0xff", sep_charset, qlead_sym, qtrail_sym, ws_charset, flags, types, values).field_count == 5);
+    assert(row.col_values.size() == 5);
+    assert(std::get<int32_t>(values[0]) == -12 && std::get<double>(values[1]) == 2.5 && std::get<string>(values[2]) == "a description");
+    assert(std::get<bool>(values[3]) && std::get<uint16_t>(values[4]) == 255);
+    assert(read_line_values("7, , xyz", sep_charset, qlead_sym, qtrail_sym, ws_charset, flags, types, values).field_count == 3);
+    assert(std::get<int32_t>(values[0]) == 7 && std::get<double>(values[1]) == 0.0 && std::get<string>(values[2]) == "xyz");
+    assert(!std::get<bool>(values[3]) && std::get<uint16_t>(values[4]) == 0);
+    assert(read_line_values("1, 2, 3, false, 4, 5", sep_charset, qlead_sym, qtrail_sym, ws_charset, flags, types, values).field_count == 6);
+    assert(values.size() == 5);
+
+    // values that don't fit their column's type are reported & assigned the default
+    csv_line_read const bad = read_line_values("300, 1.5, abc, maybe, 0x10000", sep_charset, qlead_sym, qtrail_sym, ws_charset, flags, types, values);
+    assert(bad.field_count == 5 && bad.failed_count == 2 && bad.first_failed == 3);
+    assert(std::get<int32_t>(values[0]) == 300 && std::get<uint16_t>(values[4]) == 0 && !std::get<bool>(values[3]));
+    csv_type_vector const small_types{ csv_type::int8, csv_type::int8, csv_type::uint8, csv_type::float32 };
+    csv_value_vector small_values;
+    csv_line_read const small = read_line_values("300, 0xff, -1, 1e99", sep_charset, qlead_sym, qtrail_sym, ws_charset, flags, small_types, small_values);
+    assert(small.failed_count == 4 && small.first_failed == 0);
+    assert(std::get<int8_t>(small_values[0]) == 0 && std::get<int8_t>(small_values[1]) == 0);
+    assert(read_line_values("-128, 0x7f, 255, 2.5", sep_charset, qlead_sym, qtrail_sym, ws_charset, flags, small_types, small_values).failed_count == 0);
+    assert(std::get<int8_t>(small_values[1]) == 127 && std::get<float>(small_values[3]) == 2.5f);
+
+    // no allocations per row once the buffers have grown to the longest line
+    std::vector<string> lines;
+    for (int i = 0; i < 100; ++i)
+        lines.push_back(std::to_string(i) + ", " + std::to_string(i) + ".25, \"description number " + std::to_string(i) + "\", true, " + std::to_string(i));
+    for (auto const& line : lines) // warm-up
+        read_line_values(line, sep_charset, qlead_sym, qtrail_sym, ws_charset, flags, types, values);
+    size_t const fixed_allocs = heap_alloc_count();
+    for (int pass = 0; pass < 10; ++pass)
+        for (auto const& line : lines)
+            read_line_values(line, sep_charset, qlead_sym, qtrail_sym, ws_charset, flags, types, values);
+    assert(heap_alloc_count() == fixed_allocs);
+    assert(std::get<string>(values[2]) == "description number 99");
+
+    // variable column count: values grow to the widest line and are reused from then on
+    flags = csv_flags::detect_true_false_bool | csv_flags::allow_variable_column_count;
+    csv_value_vector var_values;
+    assert(read_line_values("1, 2.5, \"a longer description\", true, 3, extra column value", sep_charset, qlead_sym, qtrail_sym, ws_charset, flags, types, var_values).field_count == 6);
+    assert(var_values.size() == 6 && std::get<string>(var_values[5]) == "extra column value");
+    size_t const var_allocs = heap_alloc_count();
+    for (int pass = 0; pass < 10; ++pass) {
+        assert(read_line_values("2, 3.5, \"short description\"", sep_charset, qlead_sym, qtrail_sym, ws_charset, flags, types, var_values).field_count == 3);
+        assert(read_line_values("4, 5.5, \"the description\", false, 6, another extra value", sep_charset, qlead_sym, qtrail_sym, ws_charset, flags, types, var_values).field_count == 6);
+    }
+    assert(heap_alloc_count() == var_allocs);
+    assert(var_values.size() == 6 && std::get<string>(var_values[5]) == "another extra value");
+}
+
+void test_csv_follower() {
+    namespace fs = std::filesystem;
+    fs::path const path = fs::temp_directory_path() / "csv_follower_test.csv";
+    fs::path const rotated = fs::temp_directory_path() / "csv_follower_test.csv.1";
+    fs::remove(path);
+    fs::remove(rotated);
+    auto append = [&](string const& text) {
+        std::ofstream out(path, std::ios::binary | std::ios::app);
+        out << text;
+    };
+
+    csv_follower follower(path, csv_flags::has_header_row | csv_flags::skip_empty_lines | csv_flags::detect_true_false_bool);
+    std::vector<string> lines;
+    auto action = [&](std::string_view line, csv_type_vector const&) { lines.emplace_back(line); };
+    assert(follower.poll(action) == 0); // no file yet
+
+    // only complete lines are read
+    append("id,val,desc\n1,2.5,abc\n2,3");
+    assert(follower.poll(action) == 1);
+    assert(follower.col_names() == (csv_name_vector{ "id", "val", "desc" }));
+    assert(follower.offset() == 22);
+    append(".5,def\n\n");
+    if (follower.uses_inotify())
+        assert(follower.wait(std::chrono::milliseconds(1000)));
+    assert(follower.poll(action) == 1);
+    assert(lines == (std::vector<string>{ "1,2.5,abc", "2,3.5,def" }));
+    assert(follower.col_types() == (csv_type_vector{ csv_type::int8, csv_type::float64, csv_type::string }));
+    assert(!follower.wait(std::chrono::milliseconds(0)) || !follower.uses_inotify());
+    assert(follower.poll(action) == 0);
+
+    // a line end inside quotes doesn't end the line; new values widen the column types
+    append("1000,7,\"multi\nline");
+    assert(follower.poll(action) == 0);
+    assert(follower.in_quote());
+    append("\"\r\n");
+    assert(follower.poll(action) == 1);
+    assert(!follower.in_quote());
+    assert(lines.back() == "1000,7,\"multi\nline\"");
+    assert(follower.col_types() == (csv_type_vector{ csv_type::int16, csv_type::float64, csv_type::string }));
+
+    // changes to other files in the directory don't end the wait early
+    if (follower.uses_inotify()) {
+        fs::path const other = fs::temp_directory_path() / "csv_follower_other.csv";
+        follower.wait(std::chrono::milliseconds(0)); // drain the events for the appends above
+        std::thread writer([&] {
+            for (int i = 0; i < 20; ++i) {
+                std::ofstream(other, std::ios::app) << "x\n";
+                std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            }
+        });
+        auto const start = std::chrono::steady_clock::now();
+        assert(!follower.wait(std::chrono::milliseconds(200)));
+        assert(std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(190));
+        writer.join();
+        fs::remove(other);
+    }
+
+    // an action that throws leaves the lines before it read and gets its line again on the next poll
+    append("10,1,a\n11,1,b\n12,1,c\n");
+    lines.clear();
+    bool thrown = false;
+    try {
+        follower.poll([&](std::string_view line, csv_type_vector const&) {
+            if (line == "11,1,b")
+                throw std::runtime_error("insert failed");
+            lines.emplace_back(line);
+        });
+    }
+    catch (std::runtime_error const&) {
+        thrown = true;
+    }
+    assert(thrown && lines == (std::vector<string>{ "10,1,a" }));
+    assert(follower.poll(action) == 2);
+    assert(lines == (std::vector<string>{ "10,1,a", "11,1,b", "12,1,c" }));
+
+    // the saved state continues where the previous follower stopped
+    csv_follow_state const saved = follower.state();
+    append("3,4.5,ghi\n");
+    csv_follower follower2(path, csv_flags::has_header_row | csv_flags::skip_empty_lines | csv_flags::detect_true_false_bool);
+    follower2.restore(saved);
+    lines.clear();
+    assert(follower2.poll(action) == 1 && lines.back() == "3,4.5,ghi");
+
+    // truncated: read again from the start, keeping the column types
+    fs::resize_file(path, 0);
+    append("id,val,desc\n4,5.5,jkl\n");
+    lines.clear();
+    assert(follower2.poll(action) == 1);
+    assert(lines == (std::vector<string>{ "4,5.5,jkl" }));
+    assert(follower2.col_types() == (csv_type_vector{ csv_type::int16, csv_type::float64, csv_type::string }));
+
+    // rotated: lines appended to the old file before the rotation are read, then the new file from the start
+    append("9,9.5,late\n");
+    fs::rename(path, rotated);
+    append("id,val,desc\n5,6.5,mno\n6,7.5,pqr\n7,8.5,stu\n8,1e300,vwx\n");
+    lines.clear();
+#ifdef _WIN32
+    assert(follower2.poll(action) == 4);
+#else
+    assert(follower2.poll(action) == 5);
+    assert(lines.front() == "9,9.5,late");
+#endif
+    assert(lines.back() == "8,1e300,vwx");
+
+    // a quote in the middle of a value doesn't open a quoted value
+    append("12\" pipe,3, \"x\"\n4,5,  \"q\"\n");
+    assert(follower2.poll(action) == 2);
+    assert(!follower2.in_quote());
+    assert(lines.back() == "4,5,  \"q\"");
+
+    fs::remove(path);
+    fs::remove(rotated);
+}
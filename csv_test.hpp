@@ -1,6 +1,13 @@
 #pragma once
 #include "csv_reader.hpp"
 
+size_t heap_alloc_count(); // heap allocations made by the program so far
+
 void test_match_type();
 void test_eval_line_types();
 void test_accum_line_types();
+void test_col_stats();
+void test_spsc_ring();
+void test_pipeline_lines();
+void test_read_line_values();
+void test_csv_follower();
@@ -0,0 +1,20 @@
+#include "csv_test.hpp"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+// Counting allocator hook: every heap allocation in the program goes through here, so tests can assert that a code
+// path doesn't allocate. It's kept in its own file so the compiler can't inline it into callers, where g++ mistakes
+// the malloc/free pair for a new/free mismatch (-Wmismatched-new-delete).
+static std::atomic<size_t> heap_allocs{ 0 };
+
+size_t heap_alloc_count() { return heap_allocs; }
+
+void* operator new(size_t size) {
+    ++heap_allocs;
+    if (void* p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
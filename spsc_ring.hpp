@@ -0,0 +1,120 @@
+#pragma once
+#include <atomic>
+#include <bit>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
+/// <summary>
+/// Bounded lock-free ring for passing values from exactly one producer thread to exactly one consumer thread.
+/// The blocking push/pop poll the ring spin_count times before parking the thread until the other side makes
+/// progress, so a busy pipeline never sleeps and an idle one doesn't burn a core.
+/// </summary>
+template<typename T>
+class spsc_ring {
+public:
+	/// <param name="capacity">Minimum number of values the ring holds; rounded up to a power of 2.</param>
+	/// <param name="spin_count">Times push/pop poll the ring before parking.</param>
+	explicit spsc_ring(size_t capacity, size_t spin_count = 1000)
+		: slots(std::bit_ceil(std::max<size_t>(capacity, 1))), mask(slots.size() - 1), spin_count(spin_count) {}
+	spsc_ring(const spsc_ring&) = delete;
+	~spsc_ring() = default;
+
+	spsc_ring& operator=(const spsc_ring&) = delete;
+
+	size_t capacity() const { return slots.size(); }
+	bool   is_closed() const { return closed.load(std::memory_order_acquire); }
+
+	/// <summary>
+	/// Producer: add value if there's room. value is only moved from when true is returned.
+	/// </summary>
+	bool try_push(T&& value) {
+		size_t const t = tail.load(std::memory_order_relaxed);
+		if (t - head_cache == slots.size()) {
+			head_cache = head.load(std::memory_order_acquire);
+			if (t - head_cache == slots.size())
+				return false; // full
+		}
+		slots[t & mask] = std::move(value);
+		tail.store(t + 1, std::memory_order_release);
+		push_event.fetch_add(1, std::memory_order_release);
+		push_event.notify_one();
+		return true;
+	}
+
+	/// <summary>
+	/// Consumer: remove the oldest value, if any.
+	/// </summary>
+	bool try_pop(T& value) {
+		size_t const h = head.load(std::memory_order_relaxed);
+		if (h == tail_cache) {
+			tail_cache = tail.load(std::memory_order_acquire);
+			if (h == tail_cache)
+				return false; // empty
+		}
+		value = std::move(slots[h & mask]);
+		head.store(h + 1, std::memory_order_release);
+		pop_event.fetch_add(1, std::memory_order_release);
+		pop_event.notify_one();
+		return true;
+	}
+
+	/// <summary>
+	/// Producer: add value, waiting for room if the ring is full.
+	/// </summary>
+	/// <returns>false if the ring was closed before value could be added.</returns>
+	bool push(T&& value) {
+		for (size_t spin = 0; ; ++spin) {
+			if (is_closed())
+				return false;
+			uint32_t const ev = pop_event.load(std::memory_order_acquire); // read before trying so a pop in between isn't missed
+			if (try_push(std::move(value)))
+				return true;
+			if (spin >= spin_count)
+				pop_event.wait(ev, std::memory_order_acquire);
+		}
+	}
+
+	/// <summary>
+	/// Consumer: remove the oldest value, waiting for one if the ring is empty.
+	/// </summary>
+	/// <returns>false if the ring is closed and all values pushed before it was closed have been removed.</returns>
+	bool pop(T& value) {
+		for (size_t spin = 0; ; ++spin) {
+			uint32_t const ev = push_event.load(std::memory_order_acquire);
+			if (try_pop(value))
+				return true;
+			if (is_closed())
+				return try_pop(value); // pushes made before close are visible now
+			if (spin >= spin_count)
+				push_event.wait(ev, std::memory_order_acquire);
+		}
+	}
+
+	/// <summary>
+	/// Either side: stop the ring, waking a parked producer or consumer. Values already pushed can still be popped.
+	/// </summary>
+	void close() {
+		closed.store(true, std::memory_order_release);
+		push_event.fetch_add(1, std::memory_order_release);
+		push_event.notify_all();
+		pop_event.fetch_add(1, std::memory_order_release);
+		pop_event.notify_all();
+	}
+
+private:
+	std::vector<T> slots;
+	size_t const   mask;
+	size_t const   spin_count;
+	std::atomic<bool> closed{ false };
+
+	// producer side
+	alignas(64) std::atomic<size_t> tail{ 0 };
+	size_t                          head_cache = 0;
+	std::atomic<uint32_t>           push_event{ 0 };
+
+	// consumer side
+	alignas(64) std::atomic<size_t> head{ 0 };
+	size_t                          tail_cache = 0;
+	std::atomic<uint32_t>           pop_event{ 0 };
+};